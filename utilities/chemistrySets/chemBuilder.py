@@ -1,7 +1,15 @@
 
+import argparse
 import inspect
 import os
 
+import chemKernel
+
+# Default output folder for the generated chemistry kernels
+KERNEL_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+    '../../solvers/reactingInterFoam/hsTwophaseMixtureThermo/'
+    'chemistryModels/mechanisms')
+
 class Specie(object):
     def __init__(self,name):
         self.name = name
@@ -133,6 +141,13 @@ class ChemkinInput(object):
         with open(filename,'w') as f:
             f.write(str(self))
 
+    def write_kernel(self, name, path=KERNEL_DIR):
+        # Generate the specialised C++ chemistry kernel <name>ChemistryModel
+        # for this reaction set (see chemKernel.py)
+        nS, nR = chemKernel.write_kernel(self, name, path)
+        print('Wrote %sChemistryModel.H (%d species, %d reactions) to %s'
+              % (name, nS, nR, path))
+
 def build_set(gas=None, liquid=None, extra_species=None):
 
     # first load both gas and liquid sets
@@ -158,8 +173,30 @@ def build_set(gas=None, liquid=None, extra_species=None):
     
 if __name__ == "__main__":
 
-    rxnset = build_set(gas='GasChem2',extra_species=["CH3NHNH2L","HNO3L"])
+    parser = argparse.ArgumentParser(description='Build a CHEMKIN reaction '
+        'set from the gas and liquid mechanisms, and optionally generate a '
+        'specialised C++ chemistry kernel for it')
+    parser.add_argument('-g', '--gas', default='GasChem2',
+                        help='gas mechanism (default GasChem2)')
+    parser.add_argument('-l', '--liquid', default=None,
+                        help='liquid mechanism')
+    parser.add_argument('-e', '--extra', nargs='*',
+                        default=["CH3NHNH2L","HNO3L"],
+                        help='extra (inert) species')
+    parser.add_argument('-o', '--output', default='chem.inp',
+                        help='CHEMKIN file to write (default chem.inp)')
+    parser.add_argument('-k', '--kernel', default=None, metavar='NAME',
+                        help='also generate NAMEChemistryModel.H')
+    parser.add_argument('-d', '--kernelDir', default=KERNEL_DIR,
+                        help='folder for the generated kernel')
+    args = parser.parse_args()
+
+    rxnset = build_set(gas=args.gas, liquid=args.liquid,
+                       extra_species=args.extra or None)
     
-    rxnset.write_file('chem.inp')
+    rxnset.write_file(args.output)
+
+    if args.kernel is not None:
+        rxnset.write_kernel(args.kernel, args.kernelDir)
     
 
@@ -0,0 +1,649 @@
+
+# Generates compile-time specialised C++ reaction kernels from a CHEMKIN
+# reaction set built with chemBuilder. The generated header holds a kernel
+# struct with fixed specie/reaction counts, unrolled Arrhenius, third-body and
+# fall-off rate evaluation and an analytic sparse Jacobian, plus a thin
+# ChemistryModel class template that plugs the kernel into
+# specializedChemistryModel (solvers/reactingInterFoam/hsTwophaseMixtureThermo/
+# chemistryModels/specializedChemistryModel).
+
+import math
+import os
+import re
+
+# Gas constant in the CHEMKIN default activation energy units [cal/mol/K]
+R_CAL = 1.98720425864083
+
+# Conversion of (cm3/mol)^(order-1) to (m3/kmol)^(order-1)
+CM3_PER_MOL = 1e-3
+
+AUX_KEYWORDS = ['LOW', 'TROE', 'TH', 'FORD', 'REV', 'SRI', 'HIGH', 'PLOG']
+
+HEADER = '''/*---------------------------------------------------------------------------*\\
+  =========                 |
+  \\\\      /  F ield         | OpenFOAM: The Open Source CFD Toolbox
+   \\\\    /   O peration     |
+    \\\\  /    A nd           | Copyright (C) 2011 OpenFOAM Foundation
+     \\\\/     M anipulation  |
+-------------------------------------------------------------------------------
+License
+    This file is part of OpenFOAM.
+
+    OpenFOAM is free software: you can redistribute it and/or modify it
+    under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    OpenFOAM is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+    for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with OpenFOAM.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+FOOTER = '// ************************************************************************* //\n'
+
+
+def fmt(x):
+    '''C++ literal for a float'''
+    return repr(float(x))
+
+
+def linear(terms):
+    '''C++ expression for the sum of (coefficient, expression) terms'''
+    out = ''
+    for coeff, expr in terms:
+        if coeff < 0.0:
+            out += ' - ' if out else '-'
+        elif out:
+            out += ' + '
+        if abs(coeff) != 1.0:
+            out += '%s*' % fmt(abs(coeff))
+        out += expr
+    return out or '0.0'
+
+
+def parse_side(side):
+    '''Return an ordered list of (specie, coefficient) for one side'''
+    terms = []
+    for t in side.split('+'):
+        t = t.strip()
+        if not t:
+            continue
+        m = re.match(r'^(\d+\.?\d*)(.+)$', t)
+        if m is not None:
+            coeff, sp = float(m.group(1)), m.group(2).strip()
+        else:
+            coeff, sp = 1.0, t
+
+        for i, (s, c) in enumerate(terms):
+            if s == sp:
+                terms[i] = (s, c + coeff)
+                break
+        else:
+            terms.append((sp, coeff))
+    return terms
+
+
+class KernelReaction(object):
+    '''Parsed form of a chemBuilder.Reaction'''
+
+    def __init__(self, reaction, species):
+        lines = [l.split('!')[0].strip() for l in reaction.lines]
+        lines = [l for l in lines if l]
+
+        self.text = lines[0]
+        tokens = lines[0].split()
+        A, n, Ea = [float(x) for x in tokens[-3:]]
+        equation = ''.join(tokens[:-3])
+
+        # Separate the sides
+        if '<=>' in equation:
+            lhs, rhs = equation.split('<=>')
+            self.reversible = True
+        elif '=>' in equation:
+            lhs, rhs = equation.split('=>')
+            self.reversible = False
+        else:
+            lhs, rhs = equation.split('=')
+            self.reversible = True
+
+        # Third body and fall-off
+        self.falloff = False
+        self.thirdBody = False
+        self.pDependentSpecie = None
+
+        m = re.search(r'\(\+([^)]+)\)', lhs)
+        if m is not None:
+            self.falloff = True
+            if m.group(1) != 'M':
+                self.pDependentSpecie = m.group(1)
+            lhs = lhs.replace(m.group(0), '')
+            rhs = re.sub(r'\(\+[^)]+\)', '', rhs)
+        else:
+            if re.search(r'\+M$', lhs) or re.search(r'\+M\+', lhs + '+'):
+                self.thirdBody = True
+                lhs = re.sub(r'\+M(?=\+|$)', '', lhs)
+                rhs = re.sub(r'\+M(?=\+|$)', '', rhs)
+
+        self.reactants = parse_side(lhs)
+        self.products = parse_side(rhs)
+
+        # Auxiliary data
+        self.low = None
+        self.troe = None
+        self.th = None
+        self.efficiencies = {}
+        forders = {}
+
+        for l in lines[1:]:
+            for kw, vals in re.findall(r'\b([A-Z]+)\s*/([^/]*)/', l):
+                if kw in AUX_KEYWORDS:
+                    if kw == 'LOW':
+                        self.low = [float(x) for x in vals.split()]
+                    elif kw == 'TROE':
+                        self.troe = [float(x) for x in vals.split()]
+                    elif kw == 'TH':
+                        self.th = [float(x) for x in vals.split()]
+                    elif kw == 'FORD':
+                        sp, e = vals.split()
+                        forders[sp] = float(e)
+                    else:
+                        raise ValueError('Unsupported keyword %s in "%s"' %
+                                         (kw, self.text))
+            l = re.sub(r'\b(%s)\s*/[^/]*/' % '|'.join(AUX_KEYWORDS), '', l)
+            l = re.sub(r'\bDUP(LICATE)?\b', '', l)
+
+            for sp, eff in re.findall(r'(\S+?)\s*/\s*([-+0-9.eEdD]+)\s*/', l):
+                if sp in species:
+                    self.efficiencies[sp] = float(eff.replace('D', 'E'))
+
+        if self.falloff and self.low is None:
+            raise ValueError('Missing LOW for fall-off reaction "%s"'
+                             % self.text)
+
+        # Map to specie indices
+        idx = dict((s, i) for i, s in enumerate(species))
+        for s, c in self.reactants + self.products:
+            if s not in idx:
+                raise ValueError('Unknown specie %s in "%s"' % (s, self.text))
+
+        self.fwd = [(idx[s], forders.get(s, c)) for s, c in self.reactants]
+        self.rev = [(idx[s], c) for s, c in self.products]
+
+        self.nu = {}
+        for s, c in self.reactants:
+            self.nu[idx[s]] = self.nu.get(idx[s], 0.0) - c
+        for s, c in self.products:
+            self.nu[idx[s]] = self.nu.get(idx[s], 0.0) + c
+        self.nu = dict((i, v) for i, v in self.nu.items() if v != 0.0)
+
+        self.eff = [1.0]*len(species)
+        for s, e in self.efficiencies.items():
+            self.eff[idx[s]] = e
+        if self.pDependentSpecie is not None:
+            self.eff = [0.0]*len(species)
+            self.eff[idx[self.pDependentSpecie]] = 1.0
+
+        # Convert to SI (kmol, m3, s, K)
+        order = sum(e for i, e in self.fwd)
+        mOrder = order + (1.0 if self.thirdBody else 0.0)
+        self.A = A*CM3_PER_MOL**(mOrder - 1.0)
+        self.n = n
+        self.Ta = Ea/R_CAL
+
+        if self.falloff:
+            A0, n0, Ea0 = self.low
+            self.A0 = A0*CM3_PER_MOL**order
+            self.n0 = n0
+            self.Ta0 = Ea0/R_CAL
+
+    @property
+    def usesM(self):
+        return self.thirdBody or self.falloff
+
+    # ----------------------------------------------------------------------
+
+    @staticmethod
+    def arrhenius(A, n, Ta):
+        if n == 0.0 and Ta == 0.0:
+            return fmt(A)
+        expr = []
+        if n != 0.0:
+            expr.append((n, 'logT'))
+        if Ta != 0.0:
+            expr.append((-Ta, 'rT'))
+        return '%s*exp(%s)' % (fmt(A), linear(expr))
+
+    @staticmethod
+    def power(i, e):
+        if e == int(e) and 0 < e <= 4:
+            return '*'.join(['c[%d]' % i]*int(e))
+        return 'pow(c[%d], %s)' % (i, fmt(e))
+
+    @classmethod
+    def product(cls, terms):
+        return '*'.join(cls.power(i, e) for i, e in terms) or '1.0'
+
+    @classmethod
+    def dproduct(cls, terms, j):
+        '''Derivative of the product of terms with respect to c[j]'''
+        expr = []
+        for i, e in terms:
+            if i == j:
+                if e == 1.0:
+                    continue
+                elif e == 2.0:
+                    expr.append('2.0*c[%d]' % i)
+                elif e == int(e) and 2 < e <= 4:
+                    expr.append('%s*%s' % (fmt(e), cls.power(i, e - 1)))
+                else:
+                    expr.append('%s*pow(max(c[%d], VSMALL), %s)'
+                                % (fmt(e), i, fmt(e - 1)))
+            else:
+                expr.append(cls.power(i, e))
+        return '*'.join(expr) or '1.0'
+
+    def M_expr(self):
+        '''Third body concentration from cTot and the efficiencies'''
+        if self.pDependentSpecie is not None:
+            return 'c[%d]' % self.eff.index(1.0)
+        terms = [(1.0, 'cTot')]
+        for i, e in enumerate(self.eff):
+            if e != 1.0:
+                terms.append((e - 1.0, 'c[%d]' % i))
+        return linear(terms)
+
+    def Kc_expr(self):
+        dG = linear([(-v, 'gRT[%d]' % i) for i, v in sorted(self.nu.items())])
+        dn = sum(self.nu.values())
+        expr = 'exp(%s)' % dG
+        if dn == 0.0:
+            pass
+        elif dn == 1.0:
+            expr += '*PstdByRT'
+        elif dn == -1.0:
+            expr += '/PstdByRT'
+        else:
+            expr += '*pow(PstdByRT, %s)' % fmt(dn)
+        return expr
+
+    def rate_lines(self, jacobian):
+        '''Lines defining kf (and dkfdM for the Jacobian) and kr'''
+        L = []
+        if self.usesM:
+            L.append('const scalar M = %s;' % self.M_expr())
+
+        if self.falloff:
+            L.append('const scalar kInf = %s;'
+                     % self.arrhenius(self.A, self.n, self.Ta))
+            L.append('const scalar k0 = %s;'
+                     % self.arrhenius(self.A0, self.n0, self.Ta0))
+            L.append('const scalar Pr = k0*M/max(kInf, VSMALL);')
+
+            if self.troe is not None:
+                a, T3, T1 = self.troe[:3]
+                Fcent = '%s*exp(-T/%s) + %s*exp(-T/%s)' % \
+                        (fmt(1.0 - a), fmt(T3), fmt(a), fmt(T1))
+                if len(self.troe) > 3:
+                    Fcent += ' + exp(%s*rT)' % fmt(-self.troe[3])
+                L.append('const scalar logFcent = log10(max(%s, SMALL));'
+                         % Fcent)
+                L.append('const scalar cc = -0.4 - 0.67*logFcent;')
+                L.append('const scalar nn = 0.75 - 1.27*logFcent;')
+                L.append('const scalar x = log10(max(Pr, SMALL)) + cc;')
+                L.append('const scalar den = nn - 0.14*x;')
+                L.append('const scalar f1 = x/den;')
+                L.append('const scalar F = '
+                         'pow(10.0, logFcent/(1.0 + f1*f1));')
+                if jacobian:
+                    L.append('const scalar dlogFdlogPr = -2.0*logFcent*f1'
+                             '/sqr(1.0 + f1*f1)*nn/(den*den);')
+            elif self.th is not None:
+                a0 = self.th[0]
+                a1 = self.th[1] if len(self.th) > 1 else 0.0
+                L.append('const scalar logFcent = log10(max(%s + %s*T, '
+                         'SMALL));' % (fmt(a0), fmt(a1)))
+                L.append('const scalar x = log10(max(Pr, SMALL));')
+                L.append('const scalar F = pow(10.0, logFcent/(1.0 + x*x));')
+                if jacobian:
+                    L.append('const scalar dlogFdlogPr = '
+                             '-2.0*logFcent*x/sqr(1.0 + x*x);')
+            else:
+                L.append('const scalar F = 1.0;')
+                if jacobian:
+                    L.append('const scalar dlogFdlogPr = 0.0;')
+
+            L.append('const scalar kf = kInf*Pr/(1.0 + Pr)*F;')
+            if jacobian:
+                L.append('const scalar dkfdM = kInf*F*(1.0/sqr(1.0 + Pr) '
+                         '+ dlogFdlogPr/(1.0 + Pr))*k0/max(kInf, VSMALL);')
+
+        elif self.thirdBody:
+            L.append('const scalar k = %s;'
+                     % self.arrhenius(self.A, self.n, self.Ta))
+            L.append('const scalar kf = M*k;')
+            if jacobian:
+                L.append('const scalar dkfdM = k;')
+        else:
+            L.append('const scalar kf = %s;'
+                     % self.arrhenius(self.A, self.n, self.Ta))
+
+        if self.reversible:
+            L.append('const scalar rKc = 1.0/max(%s, VSMALL);'
+                     % self.Kc_expr())
+            L.append('const scalar kr = kf*rKc;')
+        return L
+
+    def omega_block(self, k):
+        L = self.rate_lines(False)
+        q = self.scaled('kf', self.product(self.fwd))
+        if self.reversible:
+            q += ' - %s' % self.scaled('kr', self.product(self.rev))
+        L.append('const scalar q = %s;' % q)
+        for i, v in sorted(self.nu.items()):
+            L.append(self.accumulate('dcdt[%d]' % i, v, 'q'))
+        return self.block(k, L)
+
+    def jacobian_block(self, k, nSpecie):
+        L = self.rate_lines(True)
+
+        # Direct concentration dependence of q
+        dq = {}
+        for i, e in self.fwd:
+            dq.setdefault(i, []).append((1.0, self.scaled('kf',
+                                         self.dproduct(self.fwd, i))))
+        if self.reversible:
+            for i, e in self.rev:
+                dq.setdefault(i, []).append((-1.0, self.scaled('kr',
+                                             self.dproduct(self.rev, i))))
+
+        for j in sorted(dq):
+            L.append('const scalar dqdc%d = %s;' % (j, linear(dq[j])))
+            for i, v in sorted(self.nu.items()):
+                L.append(self.accumulate('J[%d]' % (i*nSpecie + j), v,
+                                         'dqdc%d' % j))
+
+        # Dependence through the third body concentration
+        if self.usesM:
+            pr = ''
+            if self.reversible:
+                pr = ' - %s' % self.scaled('rKc', self.product(self.rev))
+            L.append('const scalar dqdM = dkfdM*(%s%s);'
+                     % (self.product(self.fwd), pr))
+            L.append('static const scalar eff[%d] =' % nSpecie)
+            L.append('{')
+            for i in range(0, nSpecie, 6):
+                L.append('    ' + ', '.join(fmt(e) for e in
+                                             self.eff[i:i + 6]) + ',')
+            L[-1] = L[-1].rstrip(',')
+            L.append('};')
+            L.append('for (label j=0; j<%d; j++)' % nSpecie)
+            L.append('{')
+            L.append('    const scalar dqdcj = dqdM*eff[j];')
+            for i, v in sorted(self.nu.items()):
+                L.append('    ' + self.accumulate('J[%d + j]' % (i*nSpecie),
+                                                  v, 'dqdcj'))
+            L.append('}')
+        return self.block(k, L)
+
+    @staticmethod
+    def scaled(k, expr):
+        return k if expr == '1.0' else '%s*%s' % (k, expr)
+
+    @staticmethod
+    def accumulate(lhs, v, rhs):
+        if v == 1.0:
+            return '%s += %s;' % (lhs, rhs)
+        elif v == -1.0:
+            return '%s -= %s;' % (lhs, rhs)
+        elif v < 0.0:
+            return '%s -= %s*%s;' % (lhs, fmt(-v), rhs)
+        return '%s += %s*%s;' % (lhs, fmt(v), rhs)
+
+    def block(self, k, L):
+        out = ['        // %d: %s' % (k, ' '.join(self.text.split()[:-3])),
+               '        {']
+        out += ['            ' + l for l in L]
+        out += ['        }', '']
+        return out
+
+
+def canonical(side):
+    '''Stoichiometry of one reaction side as specializedChemistryModel
+    writes it: specie names in ascending order, each followed by its
+    coefficient in thousandths'''
+    coeffs = {}
+    for sp, c in side:
+        coeffs[sp] = coeffs.get(sp, 0.0) + c
+    return ' + '.join('%s %d' % (sp, int(math.floor(1000*coeffs[sp] + 0.5)))
+                      for sp in sorted(coeffs))
+
+
+def reaction_hash(reactions):
+    '''32-bit FNV-1a hash of the canonical stoichiometry of the reactions,
+    checked against the reactions file by specializedChemistryModel'''
+    s = ''.join('%s=%s;' % (canonical(r.reactants), canonical(r.products))
+                for r in reactions)
+    h = 2166136261
+    for ch in s:
+        h = ((h ^ ord(ch))*16777619) & 0xffffffff
+    return h
+
+
+def kernel_header(name, species, reactions):
+    '''Text of the generated <name>ChemistryModel.H'''
+    nS = len(species)
+    L = [HEADER,
+         'Class',
+         '    Foam::%sChemistryModel' % name,
+         '',
+         'Description',
+         '    Specialised chemistry kernel for the %s mechanism' % name,
+         '    (%d species, %d reactions).' % (nS, len(reactions)),
+         '',
+         '    Generated by utilities/chemistrySets/chemBuilder.py, do not edit.',
+         '',
+         '\\*---------------------------------------------------------------------------*/',
+         '',
+         '#ifndef %sChemistryModel_H' % name,
+         '#define %sChemistryModel_H' % name,
+         '',
+         '#include "specializedChemistryModel.H"',
+         '',
+         '// * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * //',
+         '',
+         'namespace Foam',
+         '{',
+         'namespace chemistryKernels',
+         '{',
+         '',
+         'struct %s' % name,
+         '{',
+         '    static const label nSpecie = %d;' % nS,
+         '    static const label nReaction = %d;' % len(reactions),
+         '    static const unsigned reactionHash = %du;'
+         % reaction_hash(reactions),
+         '',
+         '    static const char* specieName(const label i)',
+         '    {',
+         '        static const char* names[nSpecie] =',
+         '        {']
+    L += ['            "%s"%s' % (s, ',' if i < nS - 1 else '')
+          for i, s in enumerate(species)]
+    L += ['        };',
+          '        return names[i];',
+          '    }',
+          '',
+          '    //- Net molar production rates dcdt [kmol/m3/s] from the',
+          '    //  non-negative concentrations c and the specie g/(RR*T)',
+          '    static inline void omega',
+          '    (',
+          '        const scalar T,',
+          '        const scalar* c,',
+          '        const scalar* gRT,',
+          '        scalar* dcdt',
+          '    )',
+          '    {',
+          '        const scalar logT = log(T);',
+          '        const scalar rT = 1.0/T;',
+          '        const scalar PstdByRT = specie::Pstd/(specie::RR*T);',
+          '        scalar cTot = 0.0;',
+          '',
+          '        for (label i=0; i<nSpecie; i++)',
+          '        {',
+          '            cTot += c[i];',
+          '            dcdt[i] = 0.0;',
+          '        }',
+          '']
+    for k, r in enumerate(reactions):
+        L += r.omega_block(k)
+    L += ['        (void)logT; (void)rT; (void)PstdByRT; (void)cTot; (void)gRT;',
+          '    }',
+          '',
+          '    //- Jacobian d(dcdt)/dc of the specie block (row-major, J must',
+          '    //  be zeroed by the caller)',
+          '    static inline void jacobian',
+          '    (',
+          '        const scalar T,',
+          '        const scalar* c,',
+          '        const scalar* gRT,',
+          '        scalar* J',
+          '    )',
+          '    {',
+          '        const scalar logT = log(T);',
+          '        const scalar rT = 1.0/T;',
+          '        const scalar PstdByRT = specie::Pstd/(specie::RR*T);',
+          '        scalar cTot = 0.0;',
+          '',
+          '        for (label i=0; i<nSpecie; i++)',
+          '        {',
+          '            cTot += c[i];',
+          '        }',
+          '']
+    for k, r in enumerate(reactions):
+        L += r.jacobian_block(k, nS)
+    L += ['        (void)logT; (void)rT; (void)PstdByRT; (void)cTot; (void)gRT;',
+          '    }',
+          '};',
+          '',
+          '} // End namespace chemistryKernels',
+          '',
+          '',
+          '/*---------------------------------------------------------------------------*\\',
+          '                  Class %sChemistryModel Declaration' % name,
+          '\\*---------------------------------------------------------------------------*/',
+          '',
+          'template<class CompType, class ThermoType>',
+          'class %sChemistryModel' % name,
+          ':',
+          '    public specializedChemistryModel',
+          '    <',
+          '        CompType,',
+          '        ThermoType,',
+          '        chemistryKernels::%s' % name,
+          '    >',
+          '{',
+          'public:',
+          '',
+          '    //- Runtime type information',
+          '    TypeName("%sChemistryModel");' % name,
+          '',
+          '',
+          '    // Constructors',
+          '',
+          '        //- Construct from components',
+          '        %sChemistryModel' % name,
+          '        (',
+          '            const fvMesh& mesh,',
+          '            const word& compTypeName,',
+          '            const word& thermoTypeName',
+          '        )',
+          '        :',
+          '            specializedChemistryModel',
+          '            <',
+          '                CompType,',
+          '                ThermoType,',
+          '                chemistryKernels::%s' % name,
+          '            >(mesh, compTypeName, thermoTypeName)',
+          '        {}',
+          '',
+          '',
+          '    //- Destructor',
+          '    virtual ~%sChemistryModel()' % name,
+          '    {}',
+          '};',
+          '',
+          '',
+          '// * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * //',
+          '',
+          '} // End namespace Foam',
+          '',
+          '// * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * //',
+          '',
+          '#endif',
+          '',
+          FOOTER]
+    return '\n'.join(L)
+
+
+def registration_file(names):
+    '''Text of makeMechanismChemistryModels.C for the generated kernels'''
+    L = [HEADER,
+         'Description',
+         '    Registers the generated mechanism-specific chemistry models.',
+         '',
+         '    Generated by utilities/chemistrySets/chemBuilder.py, do not edit.',
+         '',
+         '\\*---------------------------------------------------------------------------*/',
+         '',
+         '#include "makeChemistryModel.H"',
+         '',
+         '#include "rhoChemistryModel.H"',
+         '#include "psiChemistryModel.H"',
+         '#include "thermoPhysicsTypes.H"',
+         '']
+    L += ['#include "%sChemistryModel.H"' % n for n in names]
+    L += ['',
+          '// * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * //',
+          '',
+          'namespace Foam',
+          '{']
+    for n in names:
+        for comp in ['rhoChemistryModel', 'psiChemistryModel']:
+            L += ['    makeChemistryModel',
+                  '    (',
+                  '        %sChemistryModel,' % n,
+                  '        %s,' % comp,
+                  '        gasThermoPhysics',
+                  '    );',
+                  '']
+    L += ['}',
+          '',
+          FOOTER]
+    return '\n'.join(L)
+
+
+def write_kernel(reaction_set, name, path):
+    '''Write <name>ChemistryModel.H to path and update the registration file
+    so that it includes every generated kernel found in path'''
+
+    if not re.match(r'^[A-Za-z_][A-Za-z0-9_]*$', name):
+        raise ValueError('Kernel name %s is not a valid C++ identifier' % name)
+
+    species = [s for s in reaction_set.species if s]
+    reactions = [KernelReaction(r, species) for r in reaction_set.reactions]
+
+    with open(os.path.join(path, name + 'ChemistryModel.H'), 'w') as f:
+        f.write(kernel_header(name, species, reactions))
+
+    names = sorted(f[:-len('ChemistryModel.H')] for f in os.listdir(path)
+                   if f.endswith('ChemistryModel.H')
+                   and f != 'specializedChemistryModel.H')
+
+    with open(os.path.join(path, 'makeMechanismChemistryModels.C'), 'w') as f:
+        f.write(registration_file(names))
+
+    return len(species), len(reactions)